@@ -5,6 +5,11 @@
 #include "fan_pwm.h"
 #include "http_server.h"
 #include "littlefs.h"
+#include "uplink.h"
+#include "mem_budget.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "esp_timer.h"
 #include "esp_log.h"
 
 #define BME280_SCL_IO         3
@@ -15,7 +20,8 @@
 
 static i2c_master_bus_handle_t busHandle;
 static i2c_master_dev_handle_t sensorHandle;
-static float temperature = 0.0;
+static bme280_data_t reading;
+static sample_snapshot_t sample;
 
 void bme280_sensor_init(void) {
     bme280_init(&busHandle, &sensorHandle, BME280_SDA_IO, BME280_SCL_IO, BME280_SCL_DFLT_FREQ_HZ);
@@ -29,8 +35,14 @@ void app_main(void)
     esp_log_level_set("httpd_txrx", ESP_LOG_ERROR);
 
     mount_littlefs();
+    stats_init();
     clear_temp_log_file();
+#if UPLINK_ENABLED
+    wifi_init_sta();
+    uplink_start();
+#else
     wifi_init_softap();
+#endif
 
     bme280_sensor_init();
 
@@ -38,9 +50,21 @@ void app_main(void)
     fan_pwm_init(); 
 
     while (1) {
-        temperature = bme280_read_temperature(sensorHandle);
-        log_temp_to_file(temperature);
-        temperature_pwm_control(temperature, TEMP_MIN, TEMP_MAX);
+        mem_budget_hot_path_begin();
+        bme280_read_data(sensorHandle, &reading);
+        log_temp_to_file(reading.temperature);
+        uplink_enqueue_sample(reading.temperature);
+        temperature_pwm_control(reading.temperature, TEMP_MIN, TEMP_MAX);
+
+        sample.seq++;
+        sample.timestamp_us = esp_timer_get_time();
+        sample.temperature = reading.temperature;
+        sample.pressure = reading.pressure;
+        sample.humidity = reading.humidity;
+        sample.fan_duty = fan_pwm_get_duty();
+        snapshot_publish(&sample);
+        stats_add_sample(&sample);
+        mem_budget_hot_path_end();
         vTaskDelay(pdMS_TO_TICKS(2000));
     }
 }
@@ -38,16 +38,20 @@ void temperature_pwm_control(float temperature, float temp_min, float temp_max)
     if (temperature < temp_min) {
         duty = 0; 
     } else if (temperature > temp_max) {
-        duty = 8191;
+        duty = FAN_DUTY_MAX;
     } else {
-        duty = (int)((temperature - temp_min) / (temp_max - temp_min) * 8191);
+        duty = (int)((temperature - temp_min) / (temp_max - temp_min) * FAN_DUTY_MAX);
         if(duty < 0) {
             duty = 0; 
-        } else if(duty > 8191) {
-            duty = 8191; 
+        } else if(duty > FAN_DUTY_MAX) {
+            duty = FAN_DUTY_MAX; 
         }
     }
 
     ESP_ERROR_CHECK(ledc_set_duty(LEDC_MODE, LEDC_CHANNEL, duty));
     ESP_ERROR_CHECK(ledc_update_duty(LEDC_MODE, LEDC_CHANNEL));
+}
+
+int fan_pwm_get_duty(void) {
+    return duty;
 }
\ No newline at end of file
@@ -1,7 +1,10 @@
 #ifndef FAN_PWM_H
 #define FAN_PWM_H
 
+#define FAN_DUTY_MAX 8191  // 13-bit LEDC resolution
+
 void fan_pwm_init(void);
 void temperature_pwm_control(float temperature, float temp_min, float temp_max);
+int fan_pwm_get_duty(void);
 
 #endif
\ No newline at end of file
@@ -2,8 +2,16 @@
 #include "freertos/FreeRTOS.h"
 #include "esp_log.h"
 #include "esp_littlefs.h"
+#include "littlefs.h"
+#include "uplink.h"
+#include "mem_budget.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "fan_pwm.h"
 
-#define LITTLEFS_BASE_PATH "/littlefs"
+// Response buffer shared by the JSON and log handlers, allocated once with
+// the program. The server runs one handler at a time on the httpd task.
+static char response[448];
 
 esp_err_t root_handler(httpd_req_t *req) {
     const char *html_response =
@@ -14,6 +22,7 @@ esp_err_t root_handler(httpd_req_t *req) {
         "</head>"
         "<body>"
         "<h1>Temperature Monitor</h1>"
+        "<p id=\"current\"></p>"
         "<canvas id=\"tempChart\" width=\"600\" height=\"300\"></canvas>"
         "<script>"
         "async function fetchLogData() {"
@@ -48,8 +57,19 @@ esp_err_t root_handler(httpd_req_t *req) {
         "  });"
         "}"
 
+        "async function showCurrent() {"
+        "  const response = await fetch('/current');"
+        "  if (!response.ok) return;"
+        "  const s = await response.json();"
+        "  document.getElementById('current').textContent ="
+        "    `${s.temperature.toFixed(2)} °C | ${s.humidity.toFixed(1)} %RH | `"
+        "    + `${(s.pressure_pa / 100).toFixed(1)} hPa | fan ${Math.round(s.fan_percent)} %`;"
+        "}"
+
         "drawChart();"
+        "showCurrent();"
         "setInterval(drawChart, 4000);"
+        "setInterval(showCurrent, 2000);"
         "</script>"
         "</body>"
         "</html>";
@@ -61,7 +81,7 @@ esp_err_t root_handler(httpd_req_t *req) {
 
 
 esp_err_t log_handler(httpd_req_t *req) {
-    FILE *file = fopen(LITTLEFS_BASE_PATH "/temp_log.txt", "r");
+    FILE *file = open_temp_log_reader();
     if (!file) {
         httpd_resp_send_500(req);
         return ESP_FAIL;
@@ -69,16 +89,113 @@ esp_err_t log_handler(httpd_req_t *req) {
 
     httpd_resp_set_type(req, "text/plain");
 
-    char line[64];
-    while (fgets(line, sizeof(line), file)) {
-        httpd_resp_send_chunk(req, line, strlen(line));
+    while (fgets(response, sizeof(response), file)) {
+        httpd_resp_send_chunk(req, response, strlen(response));
     }
-    fclose(file);
+    close_temp_log_reader(file);
     httpd_resp_send_chunk(req, NULL, 0);
     return ESP_OK;
 }
 
 
+// Latest sample straight from RAM, no flash access
+esp_err_t current_handler(httpd_req_t *req) {
+    sample_snapshot_t s;
+    if (!snapshot_read(&s)) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
+    }
+
+    int len = snprintf(response, sizeof(response),
+             "{\"seq\":%lu,\"timestamp_us\":%lld,\"temperature\":%.2f,"
+             "\"pressure_pa\":%.1f,\"humidity\":%.2f,\"fan_duty\":%d,\"fan_percent\":%.1f}",
+             (unsigned long)s.seq, (long long)s.timestamp_us, s.temperature,
+             s.pressure, s.humidity, s.fan_duty, s.fan_duty * 100.0f / FAN_DUTY_MAX);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, len);
+    return ESP_OK;
+}
+
+
+// Constant-time summary from the streaming sketches, e.g. /stats?window=1h
+esp_err_t stats_handler(httpd_req_t *req) {
+    char query[32];
+    char window[8] = "all";
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        httpd_query_key_value(query, "window", window, sizeof(window));
+    }
+
+    stats_report_t r;
+    if (!stats_query(window, &r)) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "window must be 1h, 24h or all");
+        return ESP_FAIL;
+    }
+
+    int len = snprintf(response, sizeof(response),
+             "{\"window\":\"%s\",\"count\":%lu,\"elapsed_s\":%.0f,"
+             "\"temperature\":{\"min\":%.2f,\"max\":%.2f,\"mean\":%.2f,"
+             "\"p5\":%.2f,\"p50\":%.2f,\"p95\":%.2f},"
+             "\"fan\":{\"off\":%.3f,\"partial\":%.3f,\"saturated\":%.3f}}",
+             window, (unsigned long)r.count, r.elapsed_s,
+             r.temp_min, r.temp_max, r.temp_mean, r.temp_p5, r.temp_p50, r.temp_p95,
+             r.fan_off_share, r.fan_partial_share, r.fan_saturated_share);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, len);
+    return ESP_OK;
+}
+
+
+esp_err_t uplink_handler(httpd_req_t *req) {
+    uplink_metrics_t m;
+    uplink_get_metrics(&m);
+
+    int len = snprintf(response, sizeof(response),
+             "{\"connected\":%s,\"queue_depth\":%lu,\"queued\":%lu,"
+             "\"drained\":%lu,\"dropped\":%lu,\"drain_rate\":%.2f}",
+             m.connected ? "true" : "false",
+             (unsigned long)m.queue_depth, (unsigned long)m.queued_total,
+             (unsigned long)m.drained_total, (unsigned long)m.dropped_total,
+             m.drain_rate);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, len);
+    return ESP_OK;
+}
+
+
+esp_err_t heap_handler(httpd_req_t *req) {
+    mem_budget_report_t r;
+    mem_budget_get_report(&r);
+
+    int len = snprintf(response, sizeof(response),
+             "{\"total\":%u,\"free\":%u,\"peak_used\":%u,"
+             "\"hot_path_allocs\":%lu,\"other_allocs\":%lu,\"tasks\":{",
+             (unsigned)r.total_bytes, (unsigned)r.free_bytes, (unsigned)r.peak_used_bytes,
+             (unsigned long)r.hot_path_allocs, (unsigned long)r.other_allocs);
+    // expect_zero is false for tasks that allocate by design, e.g. uplink
+    for (uint32_t i = 0; i < r.num_tasks && len < (int)sizeof(response); i++) {
+        len += snprintf(response + len, sizeof(response) - len,
+                        "%s\"%s\":{\"allocs\":%lu,\"expect_zero\":%s}",
+                        i ? "," : "", r.tasks[i].name, (unsigned long)r.tasks[i].allocs,
+                        r.tasks[i].expect_zero ? "true" : "false");
+    }
+    if (len < (int)sizeof(response)) {
+        len += snprintf(response + len, sizeof(response) - len, "}}");
+    }
+    if (len >= (int)sizeof(response)) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, response, len);
+    return ESP_OK;
+}
+
+
 // We had add this to avoid favicon.ico missing errors
 esp_err_t favicon_handler(httpd_req_t *req) {
     httpd_resp_set_type(req, "image/x-icon");
@@ -100,6 +217,34 @@ httpd_uri_t uri_logs = {
     .user_ctx = NULL
 };
 
+httpd_uri_t uri_current = {
+    .uri      = "/current",
+    .method   = HTTP_GET,
+    .handler  = current_handler,
+    .user_ctx = NULL
+};
+
+httpd_uri_t uri_stats = {
+    .uri      = "/stats",
+    .method   = HTTP_GET,
+    .handler  = stats_handler,
+    .user_ctx = NULL
+};
+
+httpd_uri_t uri_uplink = {
+    .uri      = "/uplink",
+    .method   = HTTP_GET,
+    .handler  = uplink_handler,
+    .user_ctx = NULL
+};
+
+httpd_uri_t uri_heap = {
+    .uri      = "/heap",
+    .method   = HTTP_GET,
+    .handler  = heap_handler,
+    .user_ctx = NULL
+};
+
 httpd_uri_t uri_favicon = {
     .uri      = "/favicon.ico",
     .method   = HTTP_GET,
@@ -107,6 +252,13 @@ httpd_uri_t uri_favicon = {
     .user_ctx = NULL
 };
 
+// Runs on the httpd task once it is up: sets up newlib's per-task float
+// formatting, then counts the task's allocations from here on
+static void register_httpd_task(void *arg) {
+    snprintf(response, sizeof(response), "%.2f", 0.0);
+    mem_budget_register_task("httpd", true);
+}
+
 httpd_handle_t start_webserver(void) {
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     httpd_handle_t server = NULL;
@@ -114,6 +266,11 @@ httpd_handle_t start_webserver(void) {
         httpd_register_uri_handler(server, &uri_root);
         httpd_register_uri_handler(server, &uri_favicon);
         httpd_register_uri_handler(server, &uri_logs);
+        httpd_register_uri_handler(server, &uri_current);
+        httpd_register_uri_handler(server, &uri_stats);
+        httpd_register_uri_handler(server, &uri_uplink);
+        httpd_register_uri_handler(server, &uri_heap);
+        httpd_queue_work(server, register_httpd_task, NULL);
     }
     return server;
 }
@@ -2,6 +2,17 @@
 #include "esp_littlefs.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "mem_budget.h"
+#include <unistd.h>
+
+#if STATIC_MEMORY_BUDGET
+// The log stays open for the lifetime of the program so that logging a
+// sample never allocates a FILE or its buffer.
+static FILE *log_file;
+static char log_file_buf[256];
+static FILE *log_reader;
+static char log_reader_buf[256];
+#endif
 
 void mount_littlefs(void){
     esp_vfs_littlefs_conf_t conf = {
@@ -28,12 +39,21 @@ void format_time(char *buffer, size_t len){
 }
 
 void log_temp_to_file(float temperature) {
+#if STATIC_MEMORY_BUDGET
+    FILE *file = log_file;
+#else
     FILE *file = fopen(LITTLEFS_BASE_PATH "/temp_log.txt", "a");
+#endif
     if(file){
         char time_str[16];
         format_time(time_str, sizeof(time_str));
         fprintf(file, "%s | %.2f\n",time_str, temperature);
+#if STATIC_MEMORY_BUDGET
+        fflush(file);
+        fsync(fileno(file));
+#else
         fclose(file);
+#endif
     }else {
         ESP_LOGE("littlefs", "Failed to open temp_log.txt for writing");
     }
@@ -42,9 +62,36 @@ void log_temp_to_file(float temperature) {
 void clear_temp_log_file(void) {
     FILE *file = fopen(LITTLEFS_BASE_PATH "/temp_log.txt", "w");
     if (file) {
+#if STATIC_MEMORY_BUDGET
+        setvbuf(file, log_file_buf, _IOFBF, sizeof(log_file_buf));
+        log_file = file;
+        log_reader = fopen(LITTLEFS_BASE_PATH "/temp_log.txt", "r");
+        if (log_reader) {
+            setvbuf(log_reader, log_reader_buf, _IOFBF, sizeof(log_reader_buf));
+        }
+#else
         fclose(file);  
+#endif
         ESP_LOGI("littlefs", "Temperature log file cleared.");
     } else {
         ESP_LOGE("littlefs", "Failed to open temp_log.txt for clearing");
     }
+}
+
+FILE *open_temp_log_reader(void) {
+#if STATIC_MEMORY_BUDGET
+    if (log_reader) {
+        clearerr(log_reader);
+        rewind(log_reader);
+    }
+    return log_reader;
+#else
+    return fopen(LITTLEFS_BASE_PATH "/temp_log.txt", "r");
+#endif
+}
+
+void close_temp_log_reader(FILE *file) {
+#if !STATIC_MEMORY_BUDGET
+    fclose(file);
+#endif
 }
\ No newline at end of file
@@ -9,4 +9,9 @@ void format_time(char *buffer, size_t len);
 void log_temp_to_file(float temperature);
 void clear_temp_log_file(void);
 
+// Handle for reading the temperature log from the start; pair with
+// close_temp_log_reader. Not for concurrent use.
+FILE *open_temp_log_reader(void);
+void close_temp_log_reader(FILE *file);
+
 #endif 
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "mem_budget.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include <assert.h>
+#include <stdbool.h>
+#include <string.h>
+
+static const char *TAG = "mem_budget";
+
+typedef struct {
+    TaskHandle_t task;
+    const char *name;
+    bool expect_zero;
+    volatile uint32_t allocs;
+} tracked_task_t;
+
+static tracked_task_t tracked[MEM_BUDGET_MAX_TASKS];
+static volatile uint32_t num_tracked;
+static volatile uint32_t other_allocs;
+static volatile uint32_t hot_path_allocs;
+
+#if STATIC_MEMORY_BUDGET
+
+#if !CONFIG_HEAP_USE_HOOKS
+#error "STATIC_MEMORY_BUDGET needs CONFIG_HEAP_USE_HOOKS=y; set CONFIG_STATIC_MEMORY_BUDGET instead"
+#endif
+
+static volatile TaskHandle_t hot_path_task;
+static volatile bool steady_state;
+
+// Called by the heap component for every allocation, from any task
+void esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+    if (!steady_state) {
+        return;
+    }
+    TaskHandle_t current = xTaskGetCurrentTaskHandle();
+    if (hot_path_task && hot_path_task == current) {
+        hot_path_allocs++;
+        assert(!"heap allocation on the sample hot path");
+        return;
+    }
+    for (uint32_t i = 0; i < num_tracked; i++) {
+        if (tracked[i].task == current) {
+            tracked[i].allocs++;
+            return;
+        }
+    }
+    other_allocs++;
+}
+
+void esp_heap_trace_free_hook(void *ptr) {
+}
+
+void mem_budget_register_task(const char *name, bool expect_zero) {
+    if (num_tracked < MEM_BUDGET_MAX_TASKS) {
+        tracked[num_tracked].task = xTaskGetCurrentTaskHandle();
+        tracked[num_tracked].name = name;
+        tracked[num_tracked].expect_zero = expect_zero;
+        tracked[num_tracked].allocs = 0;
+        num_tracked++;
+    }
+}
+
+void mem_budget_hot_path_begin(void) {
+    hot_path_task = xTaskGetCurrentTaskHandle();
+}
+
+void mem_budget_hot_path_end(void) {
+    static uint32_t samples;
+
+    hot_path_task = NULL;
+    if (!steady_state) {
+        // The first sample is a warm-up: newlib sets up its per-task stdio and
+        // float formatting state lazily, on first use.
+        mem_budget_register_task("main", true);
+        steady_state = true;
+        ESP_LOGI(TAG, "Startup done, steady state from now on");
+        mem_budget_log_report();
+    }
+    if (++samples % MEM_BUDGET_REPORT_EVERY == 0) {
+        mem_budget_log_report();
+    }
+}
+
+#else
+
+void mem_budget_register_task(const char *name, bool expect_zero) {
+}
+
+void mem_budget_hot_path_begin(void) {
+}
+
+void mem_budget_hot_path_end(void) {
+}
+
+#endif
+
+void mem_budget_get_report(mem_budget_report_t *report) {
+    memset(report, 0, sizeof(*report));
+    report->total_bytes = heap_caps_get_total_size(MALLOC_CAP_DEFAULT);
+    report->free_bytes = heap_caps_get_free_size(MALLOC_CAP_DEFAULT);
+    report->peak_used_bytes = report->total_bytes - heap_caps_get_minimum_free_size(MALLOC_CAP_DEFAULT);
+    report->hot_path_allocs = hot_path_allocs;
+    report->num_tasks = num_tracked;
+    for (uint32_t i = 0; i < report->num_tasks; i++) {
+        report->tasks[i].name = tracked[i].name;
+        report->tasks[i].allocs = tracked[i].allocs;
+        report->tasks[i].expect_zero = tracked[i].expect_zero;
+    }
+    report->other_allocs = other_allocs;
+}
+
+void mem_budget_log_report(void) {
+    mem_budget_report_t report;
+    mem_budget_get_report(&report);
+    ESP_LOGI(TAG, "heap %u/%u bytes used, peak %u, hot-path allocs %lu, other tasks %lu",
+             (unsigned)(report.total_bytes - report.free_bytes), (unsigned)report.total_bytes,
+             (unsigned)report.peak_used_bytes, (unsigned long)report.hot_path_allocs,
+             (unsigned long)report.other_allocs);
+    for (uint32_t i = 0; i < report.num_tasks; i++) {
+        const mem_budget_task_count_t *task = &report.tasks[i];
+        if (!task->expect_zero) {
+            ESP_LOGI(TAG, "  %s: %lu steady-state allocs (allocates by design)", task->name,
+                     (unsigned long)task->allocs);
+        } else if (task->allocs > 0) {
+            ESP_LOGW(TAG, "  %s: %lu steady-state allocs, expected none", task->name,
+                     (unsigned long)task->allocs);
+        } else {
+            ESP_LOGI(TAG, "  %s: no steady-state allocs", task->name);
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+// Allocate every long-lived object at startup and assert if the heap is
+// touched while taking, logging or acting on a sample. Turn on with
+// "Potted plant > Static memory budget" in menuconfig, which also selects
+// CONFIG_HEAP_USE_HOOKS.
+#ifndef STATIC_MEMORY_BUDGET
+#ifdef CONFIG_STATIC_MEMORY_BUDGET
+#define STATIC_MEMORY_BUDGET 1
+#else
+#define STATIC_MEMORY_BUDGET 0
+#endif
+#endif
+
+#define MEM_BUDGET_REPORT_EVERY 150  // samples between heap reports
+#define MEM_BUDGET_MAX_TASKS    4
+
+// Allocations made by one of the app's own tasks since it was registered
+typedef struct {
+    const char *name;
+    uint32_t allocs;
+    bool expect_zero;   // false if the task allocates by design
+} mem_budget_task_count_t;
+
+typedef struct {
+    size_t total_bytes;
+    size_t free_bytes;
+    size_t peak_used_bytes;         // high-water mark since boot
+    uint32_t hot_path_allocs;       // main loop, must stay 0
+    uint32_t num_tasks;
+    mem_budget_task_count_t tasks[MEM_BUDGET_MAX_TASKS];
+    uint32_t other_allocs;          // Wi-Fi, lwip and esp-mqtt tasks
+} mem_budget_report_t;
+
+void mem_budget_hot_path_begin(void);
+void mem_budget_hot_path_end(void);
+
+// Starts counting the calling task's allocations; call once its own setup
+// is done. The main loop task registers itself after its warm-up sample.
+// expect_zero is false for a task that keeps allocating by design; it is
+// still counted, and the report says so instead of flagging it.
+void mem_budget_register_task(const char *name, bool expect_zero);
+void mem_budget_get_report(mem_budget_report_t *report);
+void mem_budget_log_report(void);
+
+#endif
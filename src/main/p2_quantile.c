@@ -0,0 +1,130 @@
+#include "p2_quantile.h"
+#include <math.h>
+
+void p2_quantile_init(p2_quantile_t *est, float p) {
+    est->p = p;
+    est->count = 0;
+    for (int i = 0; i < 5; i++) {
+        est->q[i] = 0.0f;
+        est->n[i] = i;
+    }
+    est->dn[0] = 0.0f;
+    est->dn[1] = p / 2.0f;
+    est->dn[2] = p;
+    est->dn[3] = (1.0f + p) / 2.0f;
+    est->dn[4] = 1.0f;
+}
+
+static void sort_markers(float *q, int len) {
+    for (int i = 1; i < len; i++) {
+        float v = q[i];
+        int j = i - 1;
+        while (j >= 0 && q[j] > v) {
+            q[j + 1] = q[j];
+            j--;
+        }
+        q[j + 1] = v;
+    }
+}
+
+static float parabolic(const p2_quantile_t *est, int i, int d) {
+    const float *q = est->q;
+    const int32_t *n = est->n;
+    return q[i] + (float)d / (n[i + 1] - n[i - 1]) *
+           ((n[i] - n[i - 1] + d) * (q[i + 1] - q[i]) / (n[i + 1] - n[i]) +
+            (n[i + 1] - n[i] - d) * (q[i] - q[i - 1]) / (n[i] - n[i - 1]));
+}
+
+static float linear(const p2_quantile_t *est, int i, int d) {
+    return est->q[i] + d * (est->q[i + d] - est->q[i]) / (est->n[i + d] - est->n[i]);
+}
+
+void p2_quantile_add(p2_quantile_t *est, float x) {
+    // The first five values seed the markers
+    if (est->count < 5) {
+        est->q[est->count++] = x;
+        if (est->count == 5) {
+            sort_markers(est->q, 5);
+        }
+        return;
+    }
+    est->count++;
+
+    // Find the cell x falls in, stretching the extremes if needed
+    int k;
+    if (x < est->q[0]) {
+        est->q[0] = x;
+        k = 0;
+    } else if (x >= est->q[4]) {
+        est->q[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= est->q[k + 1]) {
+            k++;
+        }
+    }
+
+    for (int i = k + 1; i < 5; i++) {
+        est->n[i]++;
+    }
+
+    // Move the middle markers towards their desired positions. These are
+    // derived from the count rather than accumulated, which would drift in
+    // float after a few million samples.
+    for (int i = 1; i < 4; i++) {
+        double d = (double)(est->count - 1) * est->dn[i] - est->n[i];
+        if ((d >= 1.0 && est->n[i + 1] - est->n[i] > 1) ||
+            (d <= -1.0 && est->n[i - 1] - est->n[i] < -1)) {
+            int ds = d > 0 ? 1 : -1;
+            float qp = parabolic(est, i, ds);
+            if (est->q[i - 1] < qp && qp < est->q[i + 1]) {
+                est->q[i] = qp;
+            } else {
+                est->q[i] = linear(est, i, ds);
+            }
+            est->n[i] += ds;
+        }
+    }
+}
+
+float p2_quantile_get(const p2_quantile_t *est) {
+    if (est->count == 0) {
+        return NAN;
+    }
+    if (est->count < 5) {
+        float sorted[5];
+        for (uint32_t i = 0; i < est->count; i++) {
+            sorted[i] = est->q[i];
+        }
+        sort_markers(sorted, est->count);
+        return sorted[(int)lroundf(est->p * (est->count - 1))];
+    }
+    return est->q[2];
+}
+
+
+int p2_quantile_markers(const p2_quantile_t *est, float *values, float *ranks) {
+    if (est->count == 0) {
+        return 0;
+    }
+    if (est->count == 1) {
+        values[0] = values[1] = est->q[0];
+        ranks[0] = 0.0f;
+        ranks[1] = 1.0f;
+        return 2;
+    }
+    if (est->count < 5) {
+        for (uint32_t i = 0; i < est->count; i++) {
+            values[i] = est->q[i];
+            ranks[i] = (float)i / (est->count - 1);
+        }
+        sort_markers(values, est->count);
+        return est->count;
+    }
+    for (int i = 0; i < 5; i++) {
+        values[i] = est->q[i];
+        ranks[i] = (float)est->n[i] / (est->count - 1);
+    }
+    return 5;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#ifndef P2_QUANTILE_H
+#define P2_QUANTILE_H
+
+#include <stdint.h>
+
+// P² streaming quantile estimator (Jain & Chlamtac, 1985): five markers,
+// O(1) time and memory per observation, no sample history.
+// Plain C with no ESP-IDF dependencies so it also builds on the host.
+typedef struct {
+    float p;            // target quantile, 0..1
+    uint32_t count;
+    float q[5];         // marker heights
+    int32_t n[5];       // actual marker positions
+    float dn[5];        // desired position increments
+} p2_quantile_t;
+
+void p2_quantile_init(p2_quantile_t *est, float p);
+void p2_quantile_add(p2_quantile_t *est, float x);
+
+// Current estimate; exact while fewer than five values have been added.
+// Returns NAN when empty.
+float p2_quantile_get(const p2_quantile_t *est);
+
+// Points of the estimated CDF: values[i] sits at rank fraction ranks[i]
+// (0 = min, 1 = max), sorted by value. Returns how many were written, at
+// most 5. Used to combine sketches that cannot be merged directly.
+int p2_quantile_markers(const p2_quantile_t *est, float *values, float *ranks);
+
+#endif
@@ -0,0 +1,32 @@
+#include "snapshot.h"
+#include <stdatomic.h>
+#include <string.h>
+
+// Double-buffered snapshot: the writer fills the slot readers are not
+// looking at, then bumps the version to make it current. A reader retries
+// only if a sample was published while it was copying; a writer preempted
+// half-way through a slot never holds readers up.
+static sample_snapshot_t slots[2];
+static atomic_uint version;
+
+void snapshot_publish(const sample_snapshot_t *sample) {
+    unsigned v = atomic_load_explicit(&version, memory_order_relaxed);
+    // Seqlock writer fence: the previous version bump must be visible before
+    // any store into the slot, which a reader may still be copying from
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slots[(v + 1) & 1], sample, sizeof(*sample));
+    atomic_store_explicit(&version, v + 1, memory_order_release);
+}
+
+bool snapshot_read(sample_snapshot_t *sample) {
+    unsigned v;
+    do {
+        v = atomic_load_explicit(&version, memory_order_acquire);
+        if (v == 0) {
+            return false;
+        }
+        memcpy(sample, &slots[v & 1], sizeof(*sample));
+        atomic_thread_fence(memory_order_acquire);
+    } while (atomic_load_explicit(&version, memory_order_relaxed) != v);
+    return true;
+}
@@ -0,0 +1,23 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Latest full sample as published by the acquisition loop
+typedef struct {
+    uint32_t seq;
+    int64_t timestamp_us;   // esp_timer time of the reading
+    float temperature;      // °C
+    float pressure;         // Pa
+    float humidity;         // %RH
+    int fan_duty;           // 0..8191
+} sample_snapshot_t;
+
+// Single writer only. Never blocks and never allocates.
+void snapshot_publish(const sample_snapshot_t *sample);
+
+// Safe from any task; returns false until the first sample is published
+bool snapshot_read(sample_snapshot_t *sample);
+
+#endif
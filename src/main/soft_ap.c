@@ -2,15 +2,36 @@
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include "esp_netif_sntp.h"
 #include <string.h>
 
 #define WIFI_SSID "Potted Plant Temp Control"
 #define WIFI_PASSWORD "104341103320"
 
+// Network joined in station mode (UPLINK_ENABLED). Like the UPLINK_*
+// settings, these can be overridden with compile definitions.
+#ifndef WIFI_STA_SSID
+#define WIFI_STA_SSID "greenhouse"
+#endif
+#ifndef WIFI_STA_PASSWORD
+#define WIFI_STA_PASSWORD "changeme"
+#endif
+
+#ifndef WIFI_STA_NTP_SERVER
+#define WIFI_STA_NTP_SERVER "pool.ntp.org"
+#endif
+
+#define WIFI_STA_RETRY_MIN_MS 1000   // first reconnect delay, doubled per failure
+#define WIFI_STA_RETRY_MAX_MS 60000
+
 static const char *TAG = "soft_ap";
 
+static esp_timer_handle_t sta_retry_timer;
+static uint32_t sta_retry_ms = WIFI_STA_RETRY_MIN_MS;
+
 void init_nvs(void){
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -43,4 +64,59 @@ void wifi_init_softap(void) {
     esp_wifi_set_config(ESP_IF_WIFI_AP, &wifi_config);
     esp_wifi_start();
     ESP_LOGI(TAG, "Connect to SSID: %s Password: %s", WIFI_SSID, WIFI_PASSWORD);
+}
+
+static void sta_retry(void *arg) {
+    esp_wifi_connect();
+}
+
+static void sta_event_handler(void *arg, esp_event_base_t event_base,
+                              int32_t event_id, void *event_data) {
+    if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
+        esp_wifi_connect();
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
+        ESP_LOGW(TAG, "Disconnected from %s, retrying in %lu ms", WIFI_STA_SSID,
+                 (unsigned long)sta_retry_ms);
+        esp_timer_start_once(sta_retry_timer, sta_retry_ms * 1000ULL);
+        sta_retry_ms = sta_retry_ms * 2 < WIFI_STA_RETRY_MAX_MS ? sta_retry_ms * 2 : WIFI_STA_RETRY_MAX_MS;
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
+        ip_event_got_ip_t *event = (ip_event_got_ip_t *)event_data;
+        sta_retry_ms = WIFI_STA_RETRY_MIN_MS;
+        ESP_LOGI(TAG, "Got IP: " IPSTR, IP2STR(&event->ip_info.ip));
+    }
+}
+
+void wifi_init_sta(void) {
+    init_nvs();
+    esp_netif_init();
+    esp_event_loop_create_default();
+    esp_netif_create_default_wifi_sta();
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    esp_wifi_init(&cfg);
+
+    const esp_timer_create_args_t retry_args = {
+        .callback = sta_retry,
+        .name = "sta_retry"
+    };
+    esp_timer_create(&retry_args, &sta_retry_timer);
+    esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, sta_event_handler, NULL);
+    esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, sta_event_handler, NULL);
+
+    wifi_config_t wifi_config = {
+        .sta = {
+            .ssid = WIFI_STA_SSID,
+            .password = WIFI_STA_PASSWORD,
+            .threshold.authmode = WIFI_AUTH_WPA2_PSK
+        },
+    };
+
+    esp_wifi_set_mode(WIFI_MODE_STA);
+    esp_wifi_set_config(WIFI_IF_STA, &wifi_config);
+    esp_wifi_start();
+    ESP_LOGI(TAG, "Connecting to SSID: %s", WIFI_STA_SSID);
+
+    // Sets the clock once the network is up, so uplink samples can be dated
+    esp_sntp_config_t sntp_config = ESP_NETIF_SNTP_DEFAULT_CONFIG(WIFI_STA_NTP_SERVER);
+    esp_netif_sntp_init(&sntp_config);
 }
\ No newline at end of file
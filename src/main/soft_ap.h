@@ -2,5 +2,6 @@
 #define SOFT_AP_H
 
 void wifi_init_softap(void);
+void wifi_init_sta(void);
 
 #endif
\ No newline at end of file
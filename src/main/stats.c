@@ -0,0 +1,307 @@
+#include "stats.h"
+#include "p2_quantile.h"
+#include "fan_pwm.h"
+#include "mem_budget.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include <math.h>
+#include <string.h>
+
+#define SLOTS_1H        12  // 5 min sub-windows
+#define SLOTS_24H       24  // 1 h sub-windows, short enough for P² to follow
+                            // the daily swing inside each one
+#define MAX_SLOTS       SLOTS_24H
+#define NUM_QUANTILES   3
+#define MAX_KNOTS       (NUM_QUANTILES * 5)
+
+static const float quantiles[NUM_QUANTILES] = { 0.05f, 0.50f, 0.95f };
+
+// Statistics for one sub-window of a sliding window
+typedef struct {
+    int64_t id;                 // timestamp / slot length; -1 = unused
+    int64_t first_us;
+    int64_t last_us;
+    uint32_t count;
+    float temp_min;
+    float temp_max;
+    double temp_sum;
+    p2_quantile_t temp_q[NUM_QUANTILES];
+    int64_t fan_off_us;
+    int64_t fan_partial_us;
+    int64_t fan_saturated_us;
+} stats_slot_t;
+
+// Sliding windows are a ring of sub-windows. A query combines the current
+// sub-window with the previous num_slots - 1, so "1h" covers the last 55 to
+// 60 minutes. "all" is a single slot that never rolls over.
+typedef struct {
+    const char *name;
+    int64_t slot_us;            // 0 = one slot since boot
+    int num_slots;
+    stats_slot_t *slots;
+} stats_window_t;
+
+static stats_slot_t slots_1h[SLOTS_1H];
+static stats_slot_t slots_24h[SLOTS_24H];
+static stats_slot_t slots_all[1];
+
+static stats_window_t windows[] = {
+    { .name = "1h",  .slot_us = 3600LL * 1000000 / SLOTS_1H,   .num_slots = SLOTS_1H, .slots = slots_1h },
+    { .name = "24h", .slot_us = 86400LL * 1000000 / SLOTS_24H, .num_slots = SLOTS_24H, .slots = slots_24h },
+    { .name = "all", .slot_us = 0, .num_slots = 1, .slots = slots_all },
+};
+#define NUM_WINDOWS (sizeof(windows) / sizeof(windows[0]))
+
+// stats_mutex guards the windows and is shared with the sampling loop, so a
+// query only holds it to copy what it needs. query_mutex guards the scratch
+// below for the rest of the query; take it first.
+static SemaphoreHandle_t stats_mutex;
+static SemaphoreHandle_t query_mutex;
+#if STATIC_MEMORY_BUDGET
+static StaticSemaphore_t stats_mutex_buf;
+static StaticSemaphore_t query_mutex_buf;
+#endif
+
+static bool have_prev;
+static int64_t prev_timestamp_us;
+static int prev_fan_duty;
+
+// Query scratch: each active slot's sample count and its CDF as (value,
+// rank) knots taken from its P² markers
+static float knot_values[MAX_SLOTS][MAX_KNOTS];
+static float knot_ranks[MAX_SLOTS][MAX_KNOTS];
+static int knot_count[MAX_SLOTS];
+static uint32_t active_count[MAX_SLOTS];
+
+static void slot_reset(stats_slot_t *s, int64_t id) {
+    s->id = id;
+    s->first_us = 0;
+    s->last_us = 0;
+    s->count = 0;
+    s->temp_min = INFINITY;
+    s->temp_max = -INFINITY;
+    s->temp_sum = 0.0;
+    for (int q = 0; q < NUM_QUANTILES; q++) {
+        p2_quantile_init(&s->temp_q[q], quantiles[q]);
+    }
+    s->fan_off_us = 0;
+    s->fan_partial_us = 0;
+    s->fan_saturated_us = 0;
+}
+
+static int64_t slot_id(const stats_window_t *w, int64_t timestamp_us) {
+    return w->slot_us ? timestamp_us / w->slot_us : 0;
+}
+
+void stats_init(void) {
+#if STATIC_MEMORY_BUDGET
+    stats_mutex = xSemaphoreCreateMutexStatic(&stats_mutex_buf);
+    query_mutex = xSemaphoreCreateMutexStatic(&query_mutex_buf);
+#else
+    stats_mutex = xSemaphoreCreateMutex();
+    query_mutex = xSemaphoreCreateMutex();
+#endif
+    for (size_t i = 0; i < NUM_WINDOWS; i++) {
+        for (int j = 0; j < windows[i].num_slots; j++) {
+            slot_reset(&windows[i].slots[j], -1);
+        }
+    }
+}
+
+void stats_add_sample(const sample_snapshot_t *sample) {
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    // The time since the previous sample is credited to the fan state that
+    // was in effect during it
+    int64_t dt_us = have_prev ? sample->timestamp_us - prev_timestamp_us : 0;
+
+    for (size_t i = 0; i < NUM_WINDOWS; i++) {
+        stats_window_t *w = &windows[i];
+        int64_t id = slot_id(w, sample->timestamp_us);
+        stats_slot_t *s = &w->slots[id % w->num_slots];
+        if (s->id != id) {
+            slot_reset(s, id);
+        }
+
+        if (s->count == 0) {
+            s->first_us = sample->timestamp_us;
+        }
+        s->last_us = sample->timestamp_us;
+        s->count++;
+        s->temp_min = fminf(s->temp_min, sample->temperature);
+        s->temp_max = fmaxf(s->temp_max, sample->temperature);
+        s->temp_sum += sample->temperature;
+        for (int q = 0; q < NUM_QUANTILES; q++) {
+            p2_quantile_add(&s->temp_q[q], sample->temperature);
+        }
+
+        if (have_prev) {
+            if (prev_fan_duty <= 0) {
+                s->fan_off_us += dt_us;
+            } else if (prev_fan_duty >= FAN_DUTY_MAX) {
+                s->fan_saturated_us += dt_us;
+            } else {
+                s->fan_partial_us += dt_us;
+            }
+        }
+    }
+
+    have_prev = true;
+    prev_timestamp_us = sample->timestamp_us;
+    prev_fan_duty = sample->fan_duty;
+    xSemaphoreGive(stats_mutex);
+}
+
+// Copies the markers of all three estimators of a slot, with stats_mutex held
+static void copy_markers(int k, const stats_slot_t *s) {
+    int n = 0;
+    for (int q = 0; q < NUM_QUANTILES; q++) {
+        n += p2_quantile_markers(&s->temp_q[q], knot_values[k] + n, knot_ranks[k] + n);
+    }
+    knot_count[k] = n;
+    active_count[k] = s->count;
+}
+
+// Sorts a slot's copied markers into one CDF
+static void build_knots(int k) {
+    float *values = knot_values[k];
+    float *ranks = knot_ranks[k];
+    int n = knot_count[k];
+
+    for (int i = 1; i < n; i++) {
+        float v = values[i];
+        float r = ranks[i];
+        int pos = i;
+        while (pos > 0 && (values[pos - 1] > v || (values[pos - 1] == v && ranks[pos - 1] > r))) {
+            values[pos] = values[pos - 1];
+            ranks[pos] = ranks[pos - 1];
+            pos--;
+        }
+        values[pos] = v;
+        ranks[pos] = r;
+    }
+    // The estimators disagree slightly; keep the CDF non-decreasing
+    for (int j = 1; j < n; j++) {
+        ranks[j] = fmaxf(ranks[j], ranks[j - 1]);
+    }
+}
+
+static float slot_cdf(int k, float x) {
+    const float *values = knot_values[k];
+    const float *ranks = knot_ranks[k];
+    int n = knot_count[k];
+
+    if (x < values[0]) {
+        return 0.0f;
+    }
+    if (x >= values[n - 1]) {
+        return 1.0f;
+    }
+    int j = 0;
+    while (x >= values[j + 1]) {
+        j++;
+    }
+    return ranks[j] + (ranks[j + 1] - ranks[j]) * (x - values[j]) / (values[j + 1] - values[j]);
+}
+
+// Quantile of the count-weighted mixture of the active slots' CDFs
+static float merged_quantile(int num_active, uint32_t total, float lo, float hi, float p) {
+    double target = (double)p * total;
+    for (int iter = 0; iter < 32; iter++) {
+        float mid = (lo + hi) / 2.0f;
+        double mass = 0.0;
+        for (int k = 0; k < num_active; k++) {
+            mass += active_count[k] * (double)slot_cdf(k, mid);
+        }
+        if (mass < target) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return hi;
+}
+
+bool stats_query(const char *window, stats_report_t *report) {
+    stats_window_t *w = NULL;
+    for (size_t i = 0; i < NUM_WINDOWS; i++) {
+        if (strcmp(windows[i].name, window) == 0) {
+            w = &windows[i];
+        }
+    }
+    if (!w) {
+        return false;
+    }
+
+    memset(report, 0, sizeof(*report));
+    xSemaphoreTake(query_mutex, portMAX_DELAY);
+    xSemaphoreTake(stats_mutex, portMAX_DELAY);
+    int64_t current_id = slot_id(w, prev_timestamp_us);
+    int64_t last_us = prev_timestamp_us;
+    int num_active = 0;
+    int64_t first_us = 0;
+    int64_t fan_off_us = 0;
+    int64_t fan_partial_us = 0;
+    int64_t fan_saturated_us = 0;
+    double temp_sum = 0.0;
+    float single[NUM_QUANTILES];
+    report->temp_min = INFINITY;
+    report->temp_max = -INFINITY;
+
+    for (int j = 0; j < w->num_slots; j++) {
+        const stats_slot_t *s = &w->slots[j];
+        if (s->id < 0 || s->id <= current_id - w->num_slots || s->count == 0) {
+            continue;
+        }
+        copy_markers(num_active, s);
+        if (num_active == 0) {
+            for (int q = 0; q < NUM_QUANTILES; q++) {
+                single[q] = p2_quantile_get(&s->temp_q[q]);
+            }
+        }
+        num_active++;
+        if (report->count == 0 || s->first_us < first_us) {
+            first_us = s->first_us;
+        }
+        report->count += s->count;
+        report->temp_min = fminf(report->temp_min, s->temp_min);
+        report->temp_max = fmaxf(report->temp_max, s->temp_max);
+        temp_sum += s->temp_sum;
+        fan_off_us += s->fan_off_us;
+        fan_partial_us += s->fan_partial_us;
+        fan_saturated_us += s->fan_saturated_us;
+    }
+    xSemaphoreGive(stats_mutex);
+
+    // Everything below works on the copies, without holding up samples
+    if (report->count > 0) {
+        int64_t fan_total_us = fan_off_us + fan_partial_us + fan_saturated_us;
+        report->elapsed_s = (last_us - first_us) / 1e6f;
+        report->temp_mean = temp_sum / report->count;
+
+        float *out[NUM_QUANTILES] = { &report->temp_p5, &report->temp_p50, &report->temp_p95 };
+        if (num_active == 1) {
+            for (int q = 0; q < NUM_QUANTILES; q++) {
+                *out[q] = single[q];
+            }
+        } else {
+            for (int k = 0; k < num_active; k++) {
+                build_knots(k);
+            }
+            for (int q = 0; q < NUM_QUANTILES; q++) {
+                *out[q] = merged_quantile(num_active, report->count,
+                                          report->temp_min, report->temp_max, quantiles[q]);
+            }
+        }
+
+        if (fan_total_us > 0) {
+            report->fan_off_share = (float)fan_off_us / fan_total_us;
+            report->fan_partial_share = (float)fan_partial_us / fan_total_us;
+            report->fan_saturated_share = (float)fan_saturated_us / fan_total_us;
+        }
+    } else {
+        report->temp_min = 0.0f;
+        report->temp_max = 0.0f;
+    }
+    xSemaphoreGive(query_mutex);
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "snapshot.h"
+
+typedef struct {
+    uint32_t count;
+    float elapsed_s;            // time between the oldest and newest sample
+    float temp_min;
+    float temp_max;
+    float temp_mean;
+    float temp_p5;
+    float temp_p50;
+    float temp_p95;
+    float fan_off_share;        // share of time at duty 0
+    float fan_partial_share;
+    float fan_saturated_share;  // share of time at FAN_DUTY_MAX
+} stats_report_t;
+
+void stats_init(void);
+
+// Called once per logged sample; constant time, never allocates
+void stats_add_sample(const sample_snapshot_t *sample);
+
+// window is "1h" (sliding in 5 min steps), "24h" (sliding in 1 h steps) or "all"
+// (since boot). Returns false for an unknown window.
+bool stats_query(const char *window, stats_report_t *report);
+
+#endif
@@ -0,0 +1,377 @@
+#include "uplink.h"
+#include "littlefs.h"
+#include "mem_budget.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "mqtt_client.h"
+#ifndef UPLINK_DEVICE_ID
+#include "esp_mac.h"
+#endif
+#include "esp_log.h"
+#include "esp_timer.h"
+#include <time.h>
+#include <unistd.h>
+
+#ifndef UPLINK_QUEUE_DIR
+#define UPLINK_QUEUE_DIR LITTLEFS_BASE_PATH
+#endif
+
+#define QUEUE_PATH UPLINK_QUEUE_DIR "/uplink_queue.bin"
+#define HEAD_PATH  UPLINK_QUEUE_DIR "/uplink_head.bin"
+#define BOOT_PATH  UPLINK_QUEUE_DIR "/uplink_boot.bin"
+
+#define UPLINK_TASK_STACK 4096
+
+// Anything earlier means SNTP has not set the clock yet (2023-11-14)
+#define CLOCK_VALID_AFTER 1700000000
+
+static const char *TAG = "uplink";
+
+// One queued sample as stored in the queue file. The queue outlives a
+// reboot, so uptime alone is not enough to place a sample: boot_count tells
+// boots apart and unix_time dates it once SNTP has set the clock (else 0).
+typedef struct {
+    uint32_t boot_count;
+    uint32_t uptime_s;
+    uint32_t unix_time;
+    float temperature;
+} uplink_record_t;
+
+static SemaphoreHandle_t queue_mutex;
+static TaskHandle_t uplink_task_handle;
+#if STATIC_MEMORY_BUDGET
+static StaticSemaphore_t queue_mutex_buf;
+static StaticTask_t uplink_task_buf;
+static StackType_t uplink_task_stack[UPLINK_TASK_STACK];
+#endif
+static esp_mqtt_client_handle_t client;
+static char topic[48];
+static uint32_t boot_count;
+
+// The queue file is append-only: records [queue_head, queue_tail) are still
+// unsent. queue_head is persisted so a reboot resumes where it left off.
+static uint32_t queue_head;
+static uint32_t queue_tail;
+
+// Append handle kept open so enqueueing a sample never allocates. It is
+// unbuffered so a failed append can be cut back to the last whole record.
+static FILE *queue_file;
+// Read and head handles, also opened once in uplink_start and only used by
+// the uplink task
+static FILE *queue_reader;
+static FILE *head_file;
+
+// Batch buffers, only touched by the uplink task
+static uplink_record_t batch_records[UPLINK_BATCH_SIZE];
+static char batch_payload[UPLINK_BATCH_SIZE * 48];
+
+// Only one batch is in flight at a time; the next one is sent once the
+// broker has acknowledged it, so a long backlog drains at the broker's pace.
+// Across a reconnect the batch stays in flight: esp-mqtt resends it from its
+// outbox and reports MQTT_EVENT_PUBLISHED with the same msg_id. It is only
+// re-read from the queue file if the outbox drops it (MQTT_EVENT_DELETED).
+static int inflight_msg_id = -1;
+static int acked_msg_id = -1;
+static uint32_t inflight_count;
+
+static uplink_metrics_t metrics;
+
+static void save_queue_head(void) {
+    if (!head_file) {
+        return;
+    }
+    rewind(head_file);
+    if (fwrite(&queue_head, sizeof(queue_head), 1, head_file) != 1 ||
+        fsync(fileno(head_file)) != 0) {
+        ESP_LOGE(TAG, "Failed to write %s", HEAD_PATH);
+        clearerr(head_file);
+    }
+}
+
+// Opens an unbuffered handle, so stdio never allocates a buffer for it
+static FILE *open_unbuffered(const char *path, const char *mode) {
+    FILE *file = fopen(path, mode);
+    if (file) {
+        setvbuf(file, NULL, _IONBF, 0);
+    } else {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+    }
+    return file;
+}
+
+// Counts boots in a file next to the queue, so records queued before a
+// reboot can be told apart from new ones
+static void load_boot_count(void) {
+    boot_count = 0;
+    FILE *file = fopen(BOOT_PATH, "r+b");
+    if (file) {
+        if (fread(&boot_count, sizeof(boot_count), 1, file) != 1) {
+            boot_count = 0;
+        }
+        rewind(file);
+    } else {
+        file = fopen(BOOT_PATH, "wb");
+    }
+    boot_count++;
+    if (!file || fwrite(&boot_count, sizeof(boot_count), 1, file) != 1) {
+        ESP_LOGE(TAG, "Failed to write %s", BOOT_PATH);
+    }
+    if (file) {
+        fclose(file);
+    }
+}
+
+static void load_queue_state(void) {
+    queue_head = 0;
+    queue_tail = 0;
+
+    FILE *file = fopen(QUEUE_PATH, "rb");
+    if (file) {
+        fseek(file, 0, SEEK_END);
+        queue_tail = ftell(file) / sizeof(uplink_record_t);
+        fclose(file);
+    }
+
+    file = fopen(HEAD_PATH, "rb");
+    if (file) {
+        if (fread(&queue_head, sizeof(queue_head), 1, file) != 1) {
+            queue_head = 0;
+        }
+        fclose(file);
+    }
+    if (queue_head > queue_tail) {
+        queue_head = queue_tail;
+    }
+}
+
+// Called with queue_mutex held once the in-flight batch has been acknowledged
+static void commit_inflight_batch(void) {
+    queue_head += inflight_count;
+    metrics.drained_total += inflight_count;
+    inflight_msg_id = -1;
+    inflight_count = 0;
+
+    if (queue_head >= queue_tail) {
+        // Fully drained: start over with an empty file
+        if (queue_file) {
+            ftruncate(fileno(queue_file), 0);
+        }
+        queue_head = 0;
+        queue_tail = 0;
+    }
+    save_queue_head();
+}
+
+static void publish_batch(void) {
+    size_t count = 0;
+
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    uint32_t depth = queue_tail - queue_head;
+    if (queue_reader) {
+        fseek(queue_reader, queue_head * sizeof(uplink_record_t), SEEK_SET);
+        count = fread(batch_records, sizeof(uplink_record_t),
+                      depth < UPLINK_BATCH_SIZE ? depth : UPLINK_BATCH_SIZE, queue_reader);
+        clearerr(queue_reader);
+    }
+    xSemaphoreGive(queue_mutex);
+
+    if (count == 0) {
+        return;
+    }
+
+    // One "boot_count,uptime_s,unix_time,temperature" line per sample
+    int len = 0;
+    for (size_t i = 0; i < count; i++) {
+        const uplink_record_t *r = &batch_records[i];
+        len += snprintf(batch_payload + len, sizeof(batch_payload) - len, "%lu,%lu,%lu,%.2f\n",
+                        (unsigned long)r->boot_count, (unsigned long)r->uptime_s,
+                        (unsigned long)r->unix_time, r->temperature);
+    }
+
+    int msg_id = esp_mqtt_client_publish(client, topic, batch_payload, len, 1, 0);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Publish failed, will retry");
+        return;
+    }
+
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    inflight_msg_id = msg_id;
+    inflight_count = count;
+    xSemaphoreGive(queue_mutex);
+}
+
+static void mqtt_event_handler(void *handler_args, esp_event_base_t base,
+                               int32_t event_id, void *event_data) {
+    esp_mqtt_event_handle_t event = event_data;
+
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "Connected to %s", UPLINK_BROKER_URI);
+        metrics.connected = true;
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "Disconnected, queueing samples");
+        metrics.connected = false;
+        break;
+    case MQTT_EVENT_PUBLISHED:
+        acked_msg_id = event->msg_id;
+        break;
+    case MQTT_EVENT_DELETED:
+        // Expired from the outbox without an ack: publish it again
+        if (event->msg_id == inflight_msg_id) {
+            ESP_LOGW(TAG, "Batch %d expired from the outbox, resending", event->msg_id);
+            inflight_msg_id = -1;
+            inflight_count = 0;
+        }
+        break;
+    default:
+        break;
+    }
+    xSemaphoreGive(queue_mutex);
+
+    xTaskNotifyGive(uplink_task_handle);
+}
+
+static void uplink_task(void *arg) {
+    // newlib sets up float formatting per task on first use; do that now so
+    // it is not counted against the steady state. Publishing still allocates:
+    // esp-mqtt copies each QoS 1 batch into its outbox on the calling task
+    // until the PUBACK, about one or two allocations per batch.
+    snprintf(batch_payload, sizeof(batch_payload), "%.2f", 0.0);
+    mem_budget_register_task("uplink", false);
+
+    int64_t last_flush_us = esp_timer_get_time();
+    int64_t rate_start_us = last_flush_us;
+    uint32_t rate_start_drained = 0;
+
+    TickType_t wait = pdMS_TO_TICKS(UPLINK_FLUSH_INTERVAL_MS);
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, wait);
+        int64_t now_us = esp_timer_get_time();
+
+        xSemaphoreTake(queue_mutex, portMAX_DELAY);
+        if (inflight_msg_id >= 0 && acked_msg_id == inflight_msg_id) {
+            commit_inflight_batch();
+        }
+        if (now_us - rate_start_us >= UPLINK_RATE_WINDOW_MS * 1000LL) {
+            metrics.drain_rate = (metrics.drained_total - rate_start_drained) * 1e6f /
+                                 (now_us - rate_start_us);
+            rate_start_us = now_us;
+            rate_start_drained = metrics.drained_total;
+        }
+        bool ready = metrics.connected && inflight_msg_id < 0;
+        uint32_t depth = queue_tail - queue_head;
+        xSemaphoreGive(queue_mutex);
+
+        // Offline, waiting for an ack or nothing queued: sleep until notified
+        // by a connect, an ack or a full batch, and recheck once per interval
+        wait = pdMS_TO_TICKS(UPLINK_FLUSH_INTERVAL_MS);
+        if (!ready || depth == 0) {
+            continue;
+        }
+        // Full batches go out immediately, partial ones once per flush interval
+        int64_t remaining_us = UPLINK_FLUSH_INTERVAL_MS * 1000LL - (now_us - last_flush_us);
+        if (depth < UPLINK_BATCH_SIZE && remaining_us > 0) {
+            wait = pdMS_TO_TICKS(remaining_us / 1000) + 1;
+            continue;
+        }
+        publish_batch();
+        last_flush_us = now_us;
+    }
+}
+
+void uplink_start(void) {
+#if STATIC_MEMORY_BUDGET
+    queue_mutex = xSemaphoreCreateMutexStatic(&queue_mutex_buf);
+#else
+    queue_mutex = xSemaphoreCreateMutex();
+#endif
+    load_boot_count();
+    load_queue_state();
+
+    queue_file = open_unbuffered(QUEUE_PATH, "ab");
+    queue_reader = open_unbuffered(QUEUE_PATH, "rb");
+    head_file = fopen(HEAD_PATH, "r+b");
+    if (head_file) {
+        setvbuf(head_file, NULL, _IONBF, 0);
+    } else {
+        head_file = open_unbuffered(HEAD_PATH, "w+b");
+    }
+    ESP_LOGI(TAG, "Boot %lu, %lu samples pending from previous runs", (unsigned long)boot_count,
+             (unsigned long)(queue_tail - queue_head));
+
+#ifdef UPLINK_DEVICE_ID
+    snprintf(topic, sizeof(topic), UPLINK_TOPIC_PREFIX "/" UPLINK_DEVICE_ID "/samples");
+#else
+    uint8_t mac[6];
+    esp_read_mac(mac, ESP_MAC_WIFI_STA);
+    snprintf(topic, sizeof(topic), UPLINK_TOPIC_PREFIX "/%02x%02x%02x%02x%02x%02x/samples",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+#endif
+
+#if STATIC_MEMORY_BUDGET
+    uplink_task_handle = xTaskCreateStatic(uplink_task, "uplink", UPLINK_TASK_STACK, NULL, 5,
+                                           uplink_task_stack, &uplink_task_buf);
+#else
+    xTaskCreate(uplink_task, "uplink", UPLINK_TASK_STACK, NULL, 5, &uplink_task_handle);
+#endif
+
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.uri = UPLINK_BROKER_URI,
+    };
+    client = esp_mqtt_client_init(&mqtt_cfg);
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
+    esp_mqtt_client_start(client);
+}
+
+void uplink_enqueue_sample(float temperature) {
+    if (!queue_mutex) {
+        return;
+    }
+
+    time_t now = time(NULL);
+    uplink_record_t record = {
+        .boot_count = boot_count,
+        .uptime_s = esp_timer_get_time() / 1000000,
+        .unix_time = now > CLOCK_VALID_AFTER ? (uint32_t)now : 0,
+        .temperature = temperature
+    };
+
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    if (queue_tail - queue_head >= UPLINK_QUEUE_MAX_SAMPLES) {
+        metrics.dropped_total++;
+    } else if (queue_file && fwrite(&record, sizeof(record), 1, queue_file) == 1 &&
+               fsync(fileno(queue_file)) == 0) {
+        queue_tail++;
+        metrics.queued_total++;
+    } else {
+        // Full partition or I/O error: drop any partial record so the file
+        // stays in step with queue_tail
+        ESP_LOGE(TAG, "Failed to append to %s", QUEUE_PATH);
+        metrics.dropped_total++;
+        if (queue_file) {
+            clearerr(queue_file);
+            ftruncate(fileno(queue_file), queue_tail * sizeof(uplink_record_t));
+        }
+    }
+    uint32_t depth = queue_tail - queue_head;
+    xSemaphoreGive(queue_mutex);
+
+    if (depth >= UPLINK_BATCH_SIZE) {
+        xTaskNotifyGive(uplink_task_handle);
+    }
+}
+
+void uplink_get_metrics(uplink_metrics_t *out) {
+    if (!queue_mutex) {
+        *out = metrics;
+        return;
+    }
+    xSemaphoreTake(queue_mutex, portMAX_DELAY);
+    *out = metrics;
+    out->queue_depth = queue_tail - queue_head;
+    xSemaphoreGive(queue_mutex);
+}
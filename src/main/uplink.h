@@ -0,0 +1,58 @@
+#ifndef UPLINK_H
+#define UPLINK_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Set to 1 to join an existing network in station mode and publish samples
+// to an MQTT broker instead of running the soft AP.
+#ifndef UPLINK_ENABLED
+#define UPLINK_ENABLED 0
+#endif
+
+#ifndef UPLINK_BROKER_URI
+#define UPLINK_BROKER_URI "mqtt://192.168.1.10"
+#endif
+
+#ifndef UPLINK_TOPIC_PREFIX
+#define UPLINK_TOPIC_PREFIX       "potted-plant"
+#endif
+#ifndef UPLINK_BATCH_SIZE
+#define UPLINK_BATCH_SIZE         32     // samples per MQTT message
+#endif
+#ifndef UPLINK_FLUSH_INTERVAL_MS
+#define UPLINK_FLUSH_INTERVAL_MS  10000  // publish a partial batch after this long
+#endif
+#ifndef UPLINK_RATE_WINDOW_MS
+#define UPLINK_RATE_WINDOW_MS     5000   // drain_rate is averaged over this long
+#endif
+#ifndef UPLINK_QUEUE_MAX_SAMPLES
+#define UPLINK_QUEUE_MAX_SAMPLES  20000  // ~320 KB of the storage partition
+#endif
+
+// The host build sets UPLINK_QUEUE_DIR and UPLINK_DEVICE_ID to use a local
+// directory and a fixed topic instead of littlefs and the station MAC
+
+// Each message carries one "boot_count,uptime_s,unix_time,temperature" line
+// per sample. boot_count is persisted and counts up on every boot, so a
+// backlog from an earlier boot stays distinguishable; unix_time is 0 for
+// samples taken before SNTP set the clock.
+
+// Delivery is at-least-once. A batch leaves the queue file only after the
+// broker's PUBACK. A batch can arrive twice if the PUBACK is lost, if the
+// device reboots while the batch is in flight, or if it expires from the
+// esp-mqtt outbox before being acknowledged.
+typedef struct {
+    uint32_t queue_depth;
+    uint32_t queued_total;
+    uint32_t drained_total;
+    uint32_t dropped_total;
+    float drain_rate;       // samples/s
+    bool connected;
+} uplink_metrics_t;
+
+void uplink_start(void);
+void uplink_enqueue_sample(float temperature);
+void uplink_get_metrics(uplink_metrics_t *metrics);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+// Minimal pthread-backed stand-in for the parts of FreeRTOS the app uses,
+// so its modules can run in a Linux host build. One tick is one millisecond.
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint32_t notify_count;
+    void (*fn)(void *);
+    void *arg;
+} StaticTask_t;
+typedef StaticTask_t *TaskHandle_t;
+
+typedef struct {
+    pthread_mutex_t mutex;
+} StaticSemaphore_t;
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY     ((TickType_t)0xffffffffUL)
+#define pdFALSE           0
+#define pdTRUE            1
+#define pdPASS            1
+
+#endif
@@ -0,0 +1,13 @@
+#include "esp_heap_caps.h"
+
+size_t heap_caps_get_total_size(uint32_t caps) {
+    return 0;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps) {
+    return 0;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t caps) {
+    return 0;
+}
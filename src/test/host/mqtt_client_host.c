@@ -0,0 +1,312 @@
+#include "mqtt_client.h"
+#include "esp_log.h"
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define OUTBOX_SIZE     16
+#define KEEPALIVE_S     30
+#define RECONNECT_MS    1000
+
+static const char *TAG = "mqtt_host";
+
+typedef struct {
+    int msg_id;         // 0 = free slot
+    uint8_t *packet;
+    size_t len;
+} outbox_entry_t;
+
+struct esp_mqtt_client {
+    char host[64];
+    char port[8];
+    esp_event_handler_t handler;
+    void *handler_args;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    int sock;
+    bool connected;
+    uint16_t next_msg_id;
+    outbox_entry_t outbox[OUTBOX_SIZE];
+};
+
+static void dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t id, int msg_id) {
+    esp_mqtt_event_t event = { .event_id = id, .client = client, .msg_id = msg_id };
+    if (client->handler) {
+        client->handler(client->handler_args, "MQTT_EVENTS", id, &event);
+    }
+}
+
+static size_t encode_remaining_length(uint8_t *out, size_t len) {
+    size_t n = 0;
+    do {
+        uint8_t byte = len % 128;
+        len /= 128;
+        out[n++] = byte | (len > 0 ? 0x80 : 0);
+    } while (len > 0);
+    return n;
+}
+
+static bool send_all(int sock, const uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t sent = send(sock, buf, len, MSG_NOSIGNAL);
+        if (sent <= 0) {
+            return false;
+        }
+        buf += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+static bool recv_all(int sock, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t got = recv(sock, buf, len, 0);
+        if (got <= 0) {
+            return false;
+        }
+        buf += got;
+        len -= got;
+    }
+    return true;
+}
+
+// Reads one packet; returns its type or -1 on error. Bodies longer than
+// body_size are not expected from a broker we only publish to.
+static int read_packet(int sock, uint8_t *body, size_t body_size, size_t *body_len) {
+    uint8_t header;
+    if (!recv_all(sock, &header, 1)) {
+        return -1;
+    }
+    size_t len = 0;
+    for (int shift = 0; shift < 28; shift += 7) {
+        uint8_t byte;
+        if (!recv_all(sock, &byte, 1)) {
+            return -1;
+        }
+        len |= (size_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            break;
+        }
+    }
+    if (len > body_size || !recv_all(sock, body, len)) {
+        return -1;
+    }
+    *body_len = len;
+    return header >> 4;
+}
+
+static int open_socket(esp_mqtt_client_handle_t client) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    if (getaddrinfo(client->host, client->port, &hints, &res) != 0) {
+        return -1;
+    }
+    int sock = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock >= 0 && connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return sock;
+}
+
+static bool mqtt_connect(esp_mqtt_client_handle_t client, int sock) {
+    char client_id[32];
+    int id_len = snprintf(client_id, sizeof(client_id), "uplink-host-%d", (int)getpid());
+
+    uint8_t packet[64];
+    size_t body_len = 10 + 2 + id_len;
+    size_t n = 0;
+    packet[n++] = 0x10;
+    n += encode_remaining_length(packet + n, body_len);
+    const uint8_t var_header[] = { 0, 4, 'M', 'Q', 'T', 'T', 4, 0x02, 0, KEEPALIVE_S };
+    memcpy(packet + n, var_header, sizeof(var_header));
+    n += sizeof(var_header);
+    packet[n++] = id_len >> 8;
+    packet[n++] = id_len & 0xff;
+    memcpy(packet + n, client_id, id_len);
+    n += id_len;
+
+    uint8_t body[4];
+    size_t len;
+    return send_all(sock, packet, n) &&
+           read_packet(sock, body, sizeof(body), &len) == 2 && len == 2 && body[1] == 0;
+}
+
+static void *mqtt_task(void *arg) {
+    esp_mqtt_client_handle_t client = arg;
+
+    while (1) {
+        int sock = open_socket(client);
+        if (sock < 0 || !mqtt_connect(client, sock)) {
+            if (sock >= 0) {
+                close(sock);
+            }
+            usleep(RECONNECT_MS * 1000);
+            continue;
+        }
+
+        // Resend whatever the broker has not acknowledged yet
+        pthread_mutex_lock(&client->lock);
+        client->sock = sock;
+        client->connected = true;
+        for (int i = 0; i < OUTBOX_SIZE; i++) {
+            if (client->outbox[i].msg_id) {
+                client->outbox[i].packet[0] |= 0x08;   // DUP
+                send_all(sock, client->outbox[i].packet, client->outbox[i].len);
+            }
+        }
+        pthread_mutex_unlock(&client->lock);
+        ESP_LOGI(TAG, "Connected to %s:%s", client->host, client->port);
+        dispatch(client, MQTT_EVENT_CONNECTED, 0);
+
+        struct pollfd pfd = { .fd = sock, .events = POLLIN };
+        while (1) {
+            int ready = poll(&pfd, 1, KEEPALIVE_S * 1000 / 2);
+            if (ready < 0) {
+                break;
+            }
+            if (ready == 0) {
+                const uint8_t ping[] = { 0xc0, 0x00 };
+                pthread_mutex_lock(&client->lock);
+                bool ok = send_all(sock, ping, sizeof(ping));
+                pthread_mutex_unlock(&client->lock);
+                if (!ok) {
+                    break;
+                }
+                continue;
+            }
+
+            uint8_t body[16];
+            size_t len;
+            int type = read_packet(sock, body, sizeof(body), &len);
+            if (type < 0) {
+                break;
+            }
+            if (type == 4 && len >= 2) {    // PUBACK
+                int msg_id = (body[0] << 8) | body[1];
+                bool known = false;
+                pthread_mutex_lock(&client->lock);
+                for (int i = 0; i < OUTBOX_SIZE; i++) {
+                    if (client->outbox[i].msg_id == msg_id) {
+                        free(client->outbox[i].packet);
+                        client->outbox[i].msg_id = 0;
+                        known = true;
+                    }
+                }
+                pthread_mutex_unlock(&client->lock);
+                if (known) {
+                    dispatch(client, MQTT_EVENT_PUBLISHED, msg_id);
+                }
+            }
+        }
+
+        pthread_mutex_lock(&client->lock);
+        client->connected = false;
+        client->sock = -1;
+        close(sock);
+        pthread_mutex_unlock(&client->lock);
+        ESP_LOGW(TAG, "Disconnected");
+        dispatch(client, MQTT_EVENT_DISCONNECTED, 0);
+        usleep(RECONNECT_MS * 1000);
+    }
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config) {
+    const char *uri = config->broker.address.uri;
+    if (strncmp(uri, "mqtt://", 7) != 0) {
+        ESP_LOGE(TAG, "Only mqtt:// URIs are supported: %s", uri);
+        return NULL;
+    }
+
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(*client));
+    if (!client) {
+        return NULL;
+    }
+    const char *host = uri + 7;
+    const char *colon = strchr(host, ':');
+    size_t host_len = colon ? (size_t)(colon - host) : strlen(host);
+    if (host_len >= sizeof(client->host)) {
+        free(client);
+        return NULL;
+    }
+    memcpy(client->host, host, host_len);
+    snprintf(client->port, sizeof(client->port), "%s", colon ? colon + 1 : "1883");
+    pthread_mutex_init(&client->lock, NULL);
+    client->sock = -1;
+    return client;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t handler, void *handler_args) {
+    client->handler = handler;
+    client->handler_args = handler_args;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client) {
+    return pthread_create(&client->thread, NULL, mqtt_task, client) == 0 ? ESP_OK : ESP_FAIL;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
+                            const char *data, int len, int qos, int retain) {
+    if (qos != 1) {
+        return -1;
+    }
+    size_t topic_len = strlen(topic);
+    size_t body_len = 2 + topic_len + 2 + len;
+    uint8_t *packet = malloc(5 + body_len);
+    if (!packet) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&client->lock);
+    outbox_entry_t *slot = NULL;
+    for (int i = 0; i < OUTBOX_SIZE && !slot; i++) {
+        if (!client->outbox[i].msg_id) {
+            slot = &client->outbox[i];
+        }
+    }
+    if (!slot) {
+        pthread_mutex_unlock(&client->lock);
+        free(packet);
+        return -1;
+    }
+    if (++client->next_msg_id == 0) {
+        client->next_msg_id = 1;
+    }
+    int msg_id = client->next_msg_id;
+
+    size_t n = 0;
+    packet[n++] = 0x30 | (qos << 1) | (retain ? 1 : 0);
+    n += encode_remaining_length(packet + n, body_len);
+    packet[n++] = topic_len >> 8;
+    packet[n++] = topic_len & 0xff;
+    memcpy(packet + n, topic, topic_len);
+    n += topic_len;
+    packet[n++] = msg_id >> 8;
+    packet[n++] = msg_id & 0xff;
+    memcpy(packet + n, data, len);
+    n += len;
+
+    slot->msg_id = msg_id;
+    slot->packet = packet;
+    slot->len = n;
+    if (client->connected) {
+        send_all(client->sock, packet, n);
+    }
+    pthread_mutex_unlock(&client->lock);
+    return msg_id;
+}
@@ -0,0 +1,127 @@
+// Compares the P² estimator used by /stats against exact percentiles
+// taken from the sorted sample set.
+
+#include "p2_quantile.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const float quantiles[] = { 0.05f, 0.50f, 0.95f };
+#define NUM_QUANTILES (sizeof(quantiles) / sizeof(quantiles[0]))
+
+static uint64_t rng_state = 0x853c49e6748fea9bULL;
+
+// xorshift64*, uniform in [0, 1)
+static double uniform01(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return ((rng_state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double normal(double mean, double sd) {
+    double u1 = uniform01();
+    double u2 = uniform01();
+    return mean + sd * sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * M_PI * u2);
+}
+
+static float gen_uniform(int i) {
+    return 18.0f + 10.0f * (float)uniform01();
+}
+
+static float gen_normal(int i) {
+    return (float)normal(23.0, 1.5);
+}
+
+// Skewed: mostly cool with a long warm tail
+static float gen_exponential(int i) {
+    return 18.0f - 2.0f * (float)log(1.0 - uniform01());
+}
+
+// Fan off at night, saturated in the afternoon
+static float gen_bimodal(int i) {
+    return uniform01() < 0.7 ? (float)normal(19.0, 0.5) : (float)normal(29.0, 0.8);
+}
+
+// Daily cycle sampled every 2 s plus sensor noise
+static float gen_daily(int i) {
+    return 23.0f + 4.0f * sinf(2.0f * (float)M_PI * i / 43200.0f) + (float)normal(0.0, 0.2);
+}
+
+static int compare_floats(const void *a, const void *b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+static float exact_quantile(const float *sorted, int count, float p) {
+    return sorted[(int)lroundf(p * (count - 1))];
+}
+
+// Runs count samples through the estimators; fails if any estimate is off
+// by more than tolerance, given as a fraction of the p5..p95 spread
+static int check(const char *name, float (*gen)(int), int count, float tolerance) {
+    p2_quantile_t est[NUM_QUANTILES];
+    for (size_t q = 0; q < NUM_QUANTILES; q++) {
+        p2_quantile_init(&est[q], quantiles[q]);
+    }
+
+    float *values = malloc(count * sizeof(float));
+    for (int i = 0; i < count; i++) {
+        values[i] = gen(i);
+        for (size_t q = 0; q < NUM_QUANTILES; q++) {
+            p2_quantile_add(&est[q], values[i]);
+        }
+    }
+    qsort(values, count, sizeof(float), compare_floats);
+
+    float spread = exact_quantile(values, count, 0.95f) - exact_quantile(values, count, 0.05f);
+    int failures = 0;
+    for (size_t q = 0; q < NUM_QUANTILES; q++) {
+        float exact = exact_quantile(values, count, quantiles[q]);
+        float estimate = p2_quantile_get(&est[q]);
+        float error = fabsf(estimate - exact);
+        bool ok = error <= tolerance * spread;
+        printf("%-12s n=%-8d p%-2.0f exact %7.3f estimate %7.3f error %.4f %s\n",
+               name, count, quantiles[q] * 100, exact, estimate, error, ok ? "" : "FAIL");
+        failures += !ok;
+    }
+    free(values);
+    return failures;
+}
+
+// Fewer than five samples are answered exactly
+static int check_small(void) {
+    p2_quantile_t est;
+    p2_quantile_init(&est, 0.5f);
+    if (!isnan(p2_quantile_get(&est))) {
+        printf("empty estimator should return NAN\n");
+        return 1;
+    }
+    p2_quantile_add(&est, 3.0f);
+    p2_quantile_add(&est, 1.0f);
+    p2_quantile_add(&est, 2.0f);
+    if (p2_quantile_get(&est) != 2.0f) {
+        printf("median of {3, 1, 2} should be 2, got %f\n", p2_quantile_get(&est));
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    int failures = check_small();
+
+    failures += check("uniform", gen_uniform, 100000, 0.01f);
+    failures += check("normal", gen_normal, 100000, 0.01f);
+    failures += check("exponential", gen_exponential, 100000, 0.01f);
+    failures += check("bimodal", gen_bimodal, 100000, 0.02f);
+    failures += check("daily", gen_daily, 43200 * 7, 0.01f);
+
+    // About six months at one sample every 2 s, as the "all" window sees it.
+    // Long enough for accumulated marker positions to lose precision.
+    failures += check("uniform-long", gen_uniform, 8000000, 0.01f);
+
+    printf(failures ? "%d FAILED\n" : "OK\n", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+// Feeds a simulated day of samples through the /stats windows and checks
+// them against exact statistics over the samples each window claims to cover.
+
+#include "stats.h"
+#include "fan_pwm.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define SAMPLE_US   2000000LL
+#define HOUR_US     3600000000LL
+#define RUN_HOURS   26
+#define MAX_SAMPLES (RUN_HOURS * 3600 / 2)
+
+static float temps[MAX_SAMPLES];
+static int duties[MAX_SAMPLES];
+static int64_t stamps[MAX_SAMPLES];
+static int num_samples;
+
+static int compare_floats(const void *a, const void *b) {
+    float x = *(const float *)a;
+    float y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Daily cycle between 18 and 30 degrees plus sensor noise. The fan is off
+// below 22 degrees and saturated above 27, like temperature_pwm_control().
+static void add(int64_t t_us) {
+    float noise = ((rand() % 1000) / 1000.0f - 0.5f) * 0.4f;
+    float temperature = 24.0f + 6.0f * sinf(2.0f * (float)M_PI * t_us / (24 * HOUR_US)) + noise;
+    int duty = (int)((temperature - 22.0f) / 5.0f * FAN_DUTY_MAX);
+    duty = duty < 0 ? 0 : duty > FAN_DUTY_MAX ? FAN_DUTY_MAX : duty;
+
+    sample_snapshot_t s = {
+        .seq = num_samples + 1,
+        .timestamp_us = t_us,
+        .temperature = temperature,
+        .fan_duty = duty,
+    };
+    temps[num_samples] = temperature;
+    duties[num_samples] = duty;
+    stamps[num_samples] = t_us;
+    num_samples++;
+    stats_add_sample(&s);
+}
+
+// Compares the window with exact values over the samples it reports covering
+static int check(const char *window, float min_s, float max_s, float tolerance) {
+    stats_report_t r;
+    if (!stats_query(window, &r)) {
+        printf("%s: unknown window\n", window);
+        return 1;
+    }
+
+    int failures = 0;
+    if (r.elapsed_s < min_s || r.elapsed_s > max_s) {
+        printf("%s: covers %.0f s, expected %.0f-%.0f s FAIL\n", window, r.elapsed_s, min_s, max_s);
+        failures++;
+    }
+
+    int64_t newest = stamps[num_samples - 1];
+    int64_t oldest = newest - (int64_t)llround(r.elapsed_s * 1e6);
+    static float covered[MAX_SAMPLES];
+    int n = 0;
+    int saturated = 0;
+    for (int i = 0; i < num_samples; i++) {
+        if (stamps[i] >= oldest - 1000000) {
+            covered[n++] = temps[i];
+            // Time after a sample is credited to its fan state
+            saturated += i > 0 && n > 1 && duties[i - 1] >= FAN_DUTY_MAX;
+        }
+    }
+    qsort(covered, n, sizeof(float), compare_floats);
+
+    if ((int)r.count != n) {
+        printf("%s: count %u, expected %d FAIL\n", window, r.count, n);
+        failures++;
+    }
+    float saturated_share = (float)saturated / (n - 1);
+    if (fabsf(r.fan_saturated_share - saturated_share) > 0.001f) {
+        printf("%s: saturated share %.4f, expected %.4f FAIL\n", window,
+               r.fan_saturated_share, saturated_share);
+        failures++;
+    }
+
+    float exact[3] = {
+        covered[(int)lroundf(0.05f * (n - 1))],
+        covered[(int)lroundf(0.50f * (n - 1))],
+        covered[(int)lroundf(0.95f * (n - 1))],
+    };
+    float estimate[3] = { r.temp_p5, r.temp_p50, r.temp_p95 };
+    float spread = exact[2] - exact[0];
+    for (int q = 0; q < 3; q++) {
+        float error = fabsf(estimate[q] - exact[q]);
+        bool ok = error <= tolerance * spread;
+        printf("%-4s %6.0f s  n=%-5d exact %7.3f estimate %7.3f error %.4f %s\n", window,
+               r.elapsed_s, n, exact[q], estimate[q], error, ok ? "" : "FAIL");
+        failures += !ok;
+    }
+    return failures;
+}
+
+int main(void) {
+    int failures = 0;
+    stats_init();
+    srand(7);
+
+    stats_report_t r;
+    if (!stats_query("1h", &r) || r.count != 0) {
+        printf("empty window reports %u samples\n", r.count);
+        failures++;
+    }
+
+    // Up to a minute past an hour boundary, mid-morning on day one: "1h"
+    // must have dropped the oldest sub-window and cover 55-60 min
+    int64_t t = 0;
+    for (; t <= 9 * HOUR_US + 60000000LL; t += SAMPLE_US) {
+        add(t);
+    }
+    failures += check("1h", 55 * 60, 60 * 60, 0.03f);
+    failures += check("24h", 9 * 3600, 9 * 3600 + 60, 0.03f);
+
+    // A day and two hours in: "24h" has rolled over, "all" has not
+    for (; t < RUN_HOURS * HOUR_US; t += SAMPLE_US) {
+        add(t);
+    }
+    failures += check("1h", 55 * 60, 60 * 60, 0.03f);
+    failures += check("24h", 22 * 3600, 24 * 3600, 0.03f);
+    failures += check("all", RUN_HOURS * 3600 - 60, RUN_HOURS * 3600, 0.03f);
+
+    if (stats_query("1w", &r)) {
+        printf("unknown window accepted\n");
+        failures++;
+    }
+
+    printf(failures ? "%d FAILED\n" : "OK\n", failures);
+    return failures ? 1 : 0;
+}
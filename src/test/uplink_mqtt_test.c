@@ -0,0 +1,493 @@
+// Runs the uplink queue and MQTT code against a local broker, e.g.
+//   mosquitto -p 1883 &
+//   ctest --test-dir build -R uplink
+// The uplink reaches the broker through a proxy in this test that can cut
+// the link, hold back PUBACKs and records every published sample line.
+// The first boot runs in a child process that exits with a batch in flight;
+// the parent then boots again on the same queue files.
+// Exits with 77 (skipped) when no broker is reachable.
+
+#include "uplink.h"
+#include "esp_timer.h"
+#include <math.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define QUEUE_PATH UPLINK_QUEUE_DIR "/uplink_queue.bin"
+#define HEAD_PATH  UPLINK_QUEUE_DIR "/uplink_head.bin"
+#define BOOT_PATH  UPLINK_QUEUE_DIR "/uplink_boot.bin"
+#define SKIPPED    77
+#define MAX_LINES  1024
+
+// A sample line as received by the broker; temperature in hundredths
+typedef struct {
+    unsigned boot_count;
+    unsigned uptime_s;
+    unsigned unix_time;
+    long centi;
+} line_t;
+
+static pthread_mutex_t proxy_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool link_up;
+static int acks_allowed = -1;       // PUBACKs still passed on; -1 = all
+static int device_sock = -1;
+static int broker_sock = -1;
+static line_t lines[MAX_LINES];
+static int num_lines;
+
+static char broker_host[64];
+static char broker_port[8];
+static int listen_sock = -1;
+
+static int connect_to(const char *host, const char *port) {
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        return -1;
+    }
+    int sock = -1;
+    for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+        sock = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (sock >= 0 && connect(sock, ai->ai_addr, ai->ai_addrlen) == 0) {
+            break;
+        }
+        if (sock >= 0) {
+            close(sock);
+            sock = -1;
+        }
+    }
+    freeaddrinfo(res);
+    return sock;
+}
+
+static bool recv_all(int sock, uint8_t *buf, size_t len) {
+    while (len > 0) {
+        ssize_t got = recv(sock, buf, len, 0);
+        if (got <= 0) {
+            return false;
+        }
+        buf += got;
+        len -= got;
+    }
+    return true;
+}
+
+// Reads one whole MQTT packet into buf; returns its type or -1
+static int read_packet(int sock, uint8_t *buf, size_t size, size_t *len, size_t *body) {
+    size_t n = 0;
+    size_t remaining = 0;
+    if (!recv_all(sock, buf, 1)) {
+        return -1;
+    }
+    n = 1;
+    for (int shift = 0; shift < 28; shift += 7) {
+        if (!recv_all(sock, buf + n, 1)) {
+            return -1;
+        }
+        remaining |= (size_t)(buf[n] & 0x7f) << shift;
+        if (!(buf[n++] & 0x80)) {
+            break;
+        }
+    }
+    if (n + remaining > size || !recv_all(sock, buf + n, remaining)) {
+        return -1;
+    }
+    *body = n;
+    *len = n + remaining;
+    return buf[0] >> 4;
+}
+
+static void record_publish(const uint8_t *packet, size_t body, size_t len) {
+    size_t topic_len = (packet[body] << 8) | packet[body + 1];
+    size_t start = body + 2 + topic_len + (((packet[0] >> 1) & 3) ? 2 : 0);
+    char payload[UPLINK_BATCH_SIZE * 48 + 1];
+    if (start > len || len - start >= sizeof(payload)) {
+        return;
+    }
+    memcpy(payload, packet + start, len - start);
+    payload[len - start] = '\0';
+
+    pthread_mutex_lock(&proxy_lock);
+    for (char *line = strtok(payload, "\n"); line && num_lines < MAX_LINES;
+         line = strtok(NULL, "\n")) {
+        line_t *l = &lines[num_lines];
+        float temperature;
+        if (sscanf(line, "%u,%u,%u,%f", &l->boot_count, &l->uptime_s, &l->unix_time,
+                   &temperature) == 4) {
+            l->centi = lroundf(temperature * 100);
+            num_lines++;
+        } else {
+            printf("malformed line: %s\n", line);
+        }
+    }
+    pthread_mutex_unlock(&proxy_lock);
+}
+
+// Passes packets both ways until either side closes
+static void forward(int device, int broker) {
+    uint8_t packet[4096];
+    struct pollfd pfd[2] = {
+        { .fd = device, .events = POLLIN },
+        { .fd = broker, .events = POLLIN },
+    };
+
+    while (poll(pfd, 2, -1) > 0) {
+        for (int i = 0; i < 2; i++) {
+            if (!pfd[i].revents) {
+                continue;
+            }
+            size_t len;
+            size_t body;
+            int type = read_packet(pfd[i].fd, packet, sizeof(packet), &len, &body);
+            if (type < 0) {
+                return;
+            }
+            if (i == 0 && type == 3) {
+                record_publish(packet, body, len);
+            }
+            if (i == 1 && type == 4) {
+                pthread_mutex_lock(&proxy_lock);
+                bool pass = acks_allowed != 0;
+                if (acks_allowed > 0) {
+                    acks_allowed--;
+                }
+                pthread_mutex_unlock(&proxy_lock);
+                if (!pass) {
+                    continue;
+                }
+            }
+            if (send(pfd[1 - i].fd, packet, len, MSG_NOSIGNAL) != (ssize_t)len) {
+                return;
+            }
+        }
+    }
+}
+
+static void *proxy_task(void *arg) {
+    while (1) {
+        int device = accept(listen_sock, NULL, NULL);
+        if (device < 0) {
+            continue;
+        }
+        pthread_mutex_lock(&proxy_lock);
+        int broker = link_up ? connect_to(broker_host, broker_port) : -1;
+        if (broker >= 0) {
+            device_sock = device;
+            broker_sock = broker;
+        }
+        pthread_mutex_unlock(&proxy_lock);
+        if (broker >= 0) {
+            forward(device, broker);
+        }
+
+        pthread_mutex_lock(&proxy_lock);
+        device_sock = -1;
+        broker_sock = -1;
+        pthread_mutex_unlock(&proxy_lock);
+        if (broker >= 0) {
+            close(broker);
+        }
+        close(device);
+    }
+    return NULL;
+}
+
+static bool start_proxy(bool up) {
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *res;
+    if (getaddrinfo("127.0.0.1", UPLINK_TEST_PROXY_PORT, &hints, &res) != 0) {
+        return false;
+    }
+    int one = 1;
+    listen_sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    bool ok = bind(listen_sock, res->ai_addr, res->ai_addrlen) == 0 && listen(listen_sock, 4) == 0;
+    freeaddrinfo(res);
+    if (!ok) {
+        printf("cannot listen on port %s\n", UPLINK_TEST_PROXY_PORT);
+        return false;
+    }
+    link_up = up;
+    pthread_t thread;
+    return pthread_create(&thread, NULL, proxy_task, NULL) == 0;
+}
+
+// Down drops the current connection and refuses new ones
+static void set_link(bool up) {
+    pthread_mutex_lock(&proxy_lock);
+    link_up = up;
+    if (!up && device_sock >= 0) {
+        shutdown(device_sock, SHUT_RDWR);
+        shutdown(broker_sock, SHUT_RDWR);
+    }
+    pthread_mutex_unlock(&proxy_lock);
+}
+
+static void set_acks_allowed(int count) {
+    pthread_mutex_lock(&proxy_lock);
+    acks_allowed = count;
+    pthread_mutex_unlock(&proxy_lock);
+}
+
+// Number of lines received for temperatures base + i/100, i in [from, to)
+static int count_received(unsigned boot_count, float base, int from, int to) {
+    int found = 0;
+    pthread_mutex_lock(&proxy_lock);
+    for (int i = from; i < to; i++) {
+        long centi = lroundf(base * 100) + i;
+        for (int j = 0; j < num_lines; j++) {
+            if (lines[j].boot_count == boot_count && lines[j].centi == centi) {
+                found++;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&proxy_lock);
+    return found;
+}
+
+static void enqueue_range(float base, int count) {
+    for (int i = 0; i < count; i++) {
+        uplink_enqueue_sample(base + i / 100.0f);
+    }
+}
+
+static bool wait_for_connected(bool connected, int timeout_ms, uplink_metrics_t *m) {
+    for (int t = 0; t < timeout_ms; t += 50) {
+        uplink_get_metrics(m);
+        if (m->connected == connected) {
+            return true;
+        }
+        usleep(50 * 1000);
+    }
+    return false;
+}
+
+static bool wait_for_drain(uint32_t drained, int timeout_ms, uplink_metrics_t *m) {
+    for (int t = 0; t < timeout_ms; t += 50) {
+        uplink_get_metrics(m);
+        if (m->drained_total >= drained && m->queue_depth == 0) {
+            return true;
+        }
+        usleep(50 * 1000);
+    }
+    return false;
+}
+
+static void print_metrics(const char *label, const uplink_metrics_t *m) {
+    printf("%s: connected %d, depth %u, queued %u, drained %u, dropped %u, rate %.1f/s\n",
+           label, m->connected, m->queue_depth, m->queued_total, m->drained_total,
+           m->dropped_total, m->drain_rate);
+}
+
+static int fail(const char *what, const uplink_metrics_t *m) {
+    print_metrics(what, m);
+    fflush(stdout);
+    return 1;
+}
+
+// Fresh queue files, backlog, partial batch, an outage mid-run, then
+// "power loss" with one batch acknowledged and the next one in flight
+static int first_boot(void) {
+    uplink_metrics_t m;
+    if (!start_proxy(false)) {
+        return 1;
+    }
+    uplink_start();
+
+    // Queued to disk before the broker is reachable: store-and-forward
+    const int backlog = UPLINK_BATCH_SIZE * 10 + 3;
+    enqueue_range(10.0f, backlog);
+    usleep(UPLINK_FLUSH_INTERVAL_MS * 2 * 1000);
+    uplink_get_metrics(&m);
+    if (m.connected || m.drained_total != 0 || m.queue_depth != (uint32_t)backlog) {
+        return fail("sent without a link", &m);
+    }
+    set_link(true);
+    if (!wait_for_connected(true, 5000, &m)) {
+        return fail("no connection through the proxy", &m);
+    }
+    if (!wait_for_drain(backlog, 10000, &m)) {
+        return fail("backlog not drained", &m);
+    }
+    print_metrics("backlog", &m);
+
+    // A partial batch goes out once the flush interval has passed
+    const int partial = UPLINK_BATCH_SIZE / 2;
+    enqueue_range(15.0f, partial);
+    if (!wait_for_drain(backlog + partial, UPLINK_FLUSH_INTERVAL_MS * 3, &m)) {
+        return fail("partial batch not flushed", &m);
+    }
+    print_metrics("partial", &m);
+
+    // Fully drained queue files are truncated, not left to grow
+    struct stat st;
+    if (stat(QUEUE_PATH, &st) != 0 || st.st_size != 0) {
+        printf("queue file not truncated after draining\n");
+        return 1;
+    }
+
+    // Outage mid-run: samples wait in the queue, then drain on reconnect
+    const int outage = UPLINK_BATCH_SIZE * 5;
+    uint32_t drained = m.drained_total;
+    set_link(false);
+    if (!wait_for_connected(false, 5000, &m)) {
+        return fail("link cut but still connected", &m);
+    }
+    enqueue_range(20.0f, outage);
+    usleep(UPLINK_FLUSH_INTERVAL_MS * 2 * 1000);
+    uplink_get_metrics(&m);
+    if (m.drained_total != drained || m.queue_depth != (uint32_t)outage) {
+        return fail("drained during the outage", &m);
+    }
+    set_link(true);
+    if (!wait_for_drain(drained + outage, 10000, &m)) {
+        return fail("outage backlog not drained", &m);
+    }
+    print_metrics("outage", &m);
+
+    // drain_rate covers the window the outage backlog drained in
+    bool rate_seen = false;
+    for (int t = 0; t < UPLINK_RATE_WINDOW_MS * 3 && !rate_seen; t += 20) {
+        uplink_get_metrics(&m);
+        rate_seen = m.drain_rate > 0.0f;
+        usleep(20 * 1000);
+    }
+    if (!rate_seen) {
+        return fail("drain_rate stayed at 0", &m);
+    }
+
+    if (count_received(1, 10.0f, 0, backlog) != backlog ||
+        count_received(1, 15.0f, 0, partial) != partial ||
+        count_received(1, 20.0f, 0, outage) != outage) {
+        printf("broker is missing samples from the first boot\n");
+        return 1;
+    }
+    if (m.dropped_total != 0 || m.queued_total != (uint32_t)(backlog + partial + outage)) {
+        return fail("unexpected counts", &m);
+    }
+
+    // Queue three batches offline, then let only the first PUBACK through
+    drained = m.drained_total;
+    set_link(false);
+    wait_for_connected(false, 5000, &m);
+    enqueue_range(30.0f, UPLINK_BATCH_SIZE * 3);
+    set_acks_allowed(1);
+    set_link(true);
+    for (int t = 0; t < 10000 && count_received(1, 30.0f, 0, UPLINK_BATCH_SIZE * 2) <
+                                     UPLINK_BATCH_SIZE * 2; t += 50) {
+        usleep(50 * 1000);
+    }
+    usleep(UPLINK_FLUSH_INTERVAL_MS * 2 * 1000);
+    uplink_get_metrics(&m);
+    if (m.drained_total != drained + UPLINK_BATCH_SIZE ||
+        m.queue_depth != UPLINK_BATCH_SIZE * 2) {
+        return fail("expected one batch acked and one in flight", &m);
+    }
+    print_metrics("before restart", &m);
+    fflush(stdout);
+    return 0;
+}
+
+// Resumes from the files left behind by the first boot
+static int second_boot(void) {
+    uplink_metrics_t m;
+    uint32_t head = 0;
+    FILE *file = fopen(HEAD_PATH, "rb");
+    if (!file || fread(&head, sizeof(head), 1, file) != 1 || head != UPLINK_BATCH_SIZE) {
+        printf("%s: head %u, expected %d\n", HEAD_PATH, head, UPLINK_BATCH_SIZE);
+        return 1;
+    }
+    fclose(file);
+
+    if (!start_proxy(true)) {
+        return 1;
+    }
+    uplink_start();
+    uplink_get_metrics(&m);
+    if (m.queue_depth != UPLINK_BATCH_SIZE * 2) {
+        return fail("pending samples not resumed", &m);
+    }
+    if (!wait_for_drain(UPLINK_BATCH_SIZE * 2, 10000, &m)) {
+        return fail("resumed queue not drained", &m);
+    }
+    print_metrics("resumed", &m);
+
+    // Only the unacknowledged samples are sent again, still tagged boot 1
+    if (count_received(1, 30.0f, 0, UPLINK_BATCH_SIZE) != 0 ||
+        count_received(1, 30.0f, UPLINK_BATCH_SIZE, UPLINK_BATCH_SIZE * 3) !=
+            UPLINK_BATCH_SIZE * 2) {
+        printf("resumed samples do not match the first boot's unacked tail\n");
+        return 1;
+    }
+
+    // New samples carry the new boot count and a wall-clock time
+    enqueue_range(40.0f, UPLINK_BATCH_SIZE);
+    if (!wait_for_drain(UPLINK_BATCH_SIZE * 3, 10000, &m)) {
+        return fail("second boot samples not drained", &m);
+    }
+    if (count_received(2, 40.0f, 0, UPLINK_BATCH_SIZE) != UPLINK_BATCH_SIZE) {
+        printf("second boot samples not tagged with boot 2\n");
+        return 1;
+    }
+    int undated = 0;
+    pthread_mutex_lock(&proxy_lock);
+    for (int i = 0; i < num_lines; i++) {
+        undated += lines[i].unix_time == 0;
+    }
+    pthread_mutex_unlock(&proxy_lock);
+    if (undated) {
+        printf("%d samples without wall-clock time\n", undated);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    esp_timer_get_time();
+
+    // Skip only if the broker itself is down; once it is reachable, any
+    // connection trouble is a failure
+    const char *uri = UPLINK_TEST_BROKER_URI;
+    const char *colon = strchr(uri + 7, ':');
+    snprintf(broker_host, sizeof(broker_host), "%.*s",
+             colon ? (int)(colon - uri - 7) : (int)strlen(uri + 7), uri + 7);
+    snprintf(broker_port, sizeof(broker_port), "%s", colon ? colon + 1 : "1883");
+    int probe = connect_to(broker_host, broker_port);
+    if (probe < 0) {
+        printf("No broker at %s, skipping\n", uri);
+        return SKIPPED;
+    }
+    close(probe);
+
+    mkdir(UPLINK_QUEUE_DIR, 0755);
+    unlink(QUEUE_PATH);
+    unlink(HEAD_PATH);
+    unlink(BOOT_PATH);
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Exit without any cleanup, as if the power went
+        _exit(first_boot());
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("first boot failed\n");
+        return 1;
+    }
+    if (second_boot() != 0) {
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}